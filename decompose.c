@@ -0,0 +1,1045 @@
+#include <math.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "decompose.h"
+#include "pool.h"
+#include "residue.h"
+#include "rref.h"
+
+#define MAX_SPLIT_DEPTH 8
+#define INVERSES_PER_TASK 64
+
+void abort_(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+uint32_t polynomial_coef_count(polynomial_t *p) {
+    for (uint32_t i = p->count; i > 0; i--) {
+        if (!is_zero(p->coefs[i-1])) return i;
+    }
+    return 0;
+}
+
+const char *superscript_digits[] = {"⁰", "¹", "²", "³", "⁴", "⁵", "⁶", "⁷", "⁸", "⁹"};
+
+void print_exponent_num(FILE *out, int num) {
+    int len = snprintf(NULL, 0, "%d", num);
+    char str[len+1];
+    snprintf(str, len + 1, "%d", num);
+    for (int i = 0; i < len; i++) {
+        fprintf(out, "%s", superscript_digits[str[i] - 0x30]);
+    }
+}
+
+void print_monomial(FILE *out, int is_first, double coef, uint32_t power) {
+    if (is_zero(coef)) return;
+    if (is_first) {
+        if (coef < 0) {
+            coef *= -1;
+            fprintf(out, "-");
+        }
+    } else {
+        if (coef < 0) {
+            coef *= -1;
+            fprintf(out, " - ");
+        } else {
+            fprintf(out, " + ");
+        }
+    }
+    if (power == 0 || !is_double_eq(coef, 1)) fprintf(out, "%g", coef);
+    if (power > 0) {
+        fprintf(out, "x");
+        if (power > 1) {
+            print_exponent_num(out, power);
+        }
+    }
+}
+
+void print_polynomial(FILE *out, polynomial_t *p) {
+    uint32_t coef_count = polynomial_coef_count(p);
+    int is_first = 1;
+    for (int32_t i = coef_count - 1; i >= 0; i--) {
+        double coef = p->coefs[i];
+        print_monomial(out, is_first, coef, i);
+        is_first = 0;
+    }
+}
+
+void print_factored(FILE *out, factored_t *f) {
+    for (uint32_t i = 0; i < f->count; i++) {
+        fprintf(out, "(");
+        print_polynomial(out, &f->factors[i]);
+        fprintf(out, ")");
+    }
+}
+
+void print_factored_list(FILE *out, factored_list_t *l) {
+    for (uint32_t i = 0; i < l->count; i++) {
+        print_factored(out, &l->factoreds[i]);
+        fprintf(out, "\n");
+    }
+}
+
+void print_polynomial_list(FILE *out, polynomial_list_t *l) {
+    for (uint32_t i = 0; i < l->count; i++) {
+        print_polynomial(out, &l->polynomials[i]);
+        fprintf(out, "\n");
+    }
+}
+
+generic_list_t *blank_list() {
+    return calloc(1, sizeof(generic_list_t));
+}
+
+void free_list(generic_list_t *list) {
+    free(list->items);
+    free(list);
+}
+
+uint32_t list_append(generic_list_t *list, uint32_t cap, size_t item_size, void *item) {
+    uint32_t count = list->count++;
+    if (count == cap) {
+        cap = (cap * 3) / 2 + 1;
+        list->items = realloc(list->items, cap * item_size);
+    }
+    memcpy(list->items + count * item_size, item, item_size);
+    return cap;
+}
+
+void free_factored(factored_t *factored) {
+    for (uint32_t i = 0; i < factored->count; i++) {
+        free(factored->factors[i].coefs);
+    }
+    free_list((generic_list_t*)factored);
+}
+
+void free_held_factored(factored_t *factored) {
+    for (uint32_t i = 0; i < factored->count; i++) {
+        free(factored->factors[i].coefs);
+    }
+    free(factored->factors);
+}
+
+void free_polynomial_list(polynomial_list_t list) {
+    for (uint32_t i = 0; i < list.count; i++) {
+        free(list.polynomials[i].coefs);
+    }
+    free(list.polynomials);
+}
+
+void free_factored_list_shallow(factored_list_t list) {
+    for (uint32_t i = 0; i < list.count; i++) {
+        free(list.factoreds[i].factors);
+    }
+    free(list.factoreds);
+}
+
+// For lists whose arrays belong to a scratch_t: frees only what they hold
+void clear_polynomial_list(polynomial_list_t list) {
+    for (uint32_t i = 0; i < list.count; i++) {
+        free(list.polynomials[i].coefs);
+    }
+}
+
+void clear_factored_list_shallow(factored_list_t list) {
+    for (uint32_t i = 0; i < list.count; i++) {
+        free(list.factoreds[i].factors);
+    }
+}
+
+polynomial_t *make_polynomial(double coefs[], uint32_t count) {
+    polynomial_t *result = malloc(sizeof(polynomial_t));
+    double *coefs_mem = malloc(sizeof(double) * count);
+    memcpy(coefs_mem, coefs, sizeof(double) * count);
+    result->coefs = coefs_mem;
+    result->count = count;
+    return result;
+}
+
+factored_t *make_factored(polynomial_t *factors[], uint32_t count) {
+    factored_t *result = malloc(sizeof(polynomial_t));
+    polynomial_t *factors_mem = malloc(sizeof(polynomial_t) * count);
+    for (uint32_t i = 0; i < count; i++) {
+        polynomial_t *factor = factors[i];
+        memcpy(factors_mem+i, factor, sizeof(polynomial_t));
+        free(factor);
+    }
+    result->factors = factors_mem;
+    result->count = count;
+    return result;
+}
+
+int polynomial_eq(polynomial_t *a, polynomial_t *b) {
+    uint32_t count = a->count;
+    if (count != b->count) return 0;
+    return memcmp(a->coefs, b->coefs, sizeof(double) * count) == 0;
+}
+
+double factor_out_constant(factored_t *f) {
+    double c = 1;
+    polynomial_t *factors = malloc(sizeof(polynomial_t) * f->count);
+    uint32_t idx = 0;
+    for (uint32_t i = 0; i < f->count; i++) {
+        polynomial_t *p = &f->factors[i];
+        if (polynomial_coef_count(p) == 1) {
+            c *= p->coefs[0];
+            free(p->coefs);
+        } else {
+            factors[idx++] = *p;
+        }
+    }
+    free(f->factors);
+    f->count = idx;
+    f->factors = factors;
+    return c;
+}
+
+// Every subset except the empty and the full one
+uint32_t combo_count(uint32_t factor_count) {
+    if (factor_count >= 32) abort_("Too many factors to count their subsets");
+    return (1u << factor_count) - 2;
+}
+
+uint32_t _all_factored_combos_append(factored_t *factors, factored_list_t *list, uint32_t cap, uint32_t stack[], uint32_t stack_count) {
+    polynomial_t *polynomials = malloc(sizeof(polynomial_t) * stack_count);
+    for (uint32_t i = 0; i < stack_count; i++) {
+        memcpy(polynomials+i, factors->factors+stack[i], sizeof(polynomial_t));
+    }
+    factored_t factored = {polynomials, stack_count};
+    return list_append((generic_list_t*)list, cap, sizeof(factored_t), &factored);
+}
+
+uint32_t _all_factored_combos_recurse(factored_t *factors, factored_list_t *list, uint32_t cap, uint32_t stack[], uint32_t *stack_count_p) {
+    uint32_t stack_top = 0;
+    uint32_t stack_count = *stack_count_p;
+    uint32_t new_stack_count = stack_count + 1;
+    *stack_count_p = new_stack_count;
+    if (stack_count > 0) {
+        stack_top = stack[stack_count-1] + 1;
+    }
+    uint32_t factor_count = factors->count;
+    for (uint32_t j = stack_top; j < factor_count; j++) {
+        stack[stack_count] = j;
+        cap = _all_factored_combos_append(
+            factors, list, cap, stack, new_stack_count);
+        if (new_stack_count < factor_count - 1) {
+            cap = _all_factored_combos_recurse(
+                factors, list, cap, stack, stack_count_p);
+        }
+    }
+    (*stack_count_p)--;
+    return cap;
+}
+
+// out->factoreds must already have room for combo_count(factors->count)
+void generate_all_factored_combos(factored_t *factors, factored_list_t *out) {
+    out->count = 0;
+    uint32_t cap = combo_count(factors->count);
+    uint32_t stack[factors->count];
+    uint32_t stack_count = 0;
+    _all_factored_combos_recurse(factors, out, cap, stack, &stack_count);
+}
+
+polynomial_t *multiply_polynomials(polynomial_t *a, polynomial_t *b, polynomial_t *result) {
+    if (result == NULL) result = malloc(sizeof(polynomial_t));
+    uint32_t ca = polynomial_coef_count(a);
+    uint32_t cb = polynomial_coef_count(b);
+    uint32_t size = ca + cb - 1;
+    double *coefs = calloc(1, sizeof(double) * size);
+    for (uint32_t i = 0; i < ca; i++) {
+        for (uint32_t j = 0; j < cb; j++) {
+            coefs[i+j] += a->coefs[i] * b->coefs[j];
+        }
+    }
+    result->count = size;
+    result->coefs = coefs;
+    return result;
+}
+
+polynomial_t *add_polynomials(polynomial_t *a, polynomial_t *b, polynomial_t *result) {
+    if (result == NULL) result = malloc(sizeof(polynomial_t));
+
+    uint32_t ca = polynomial_coef_count(a);
+    uint32_t cb = polynomial_coef_count(b);
+
+    polynomial_t *first;
+    polynomial_t *second;
+    uint32_t count;
+    uint32_t subcount;
+
+    if (ca > cb) {
+        count = ca;
+        subcount = cb;
+        first = a;
+        second = b;
+    } else {
+        count = cb;
+        subcount = ca;
+        first = b;
+        second = a;
+    }
+
+    double *coefs = malloc(sizeof(double) * count);
+    memcpy(coefs+subcount, first->coefs+subcount, sizeof(double) * (count-subcount));
+    for (uint32_t i = 0; i < subcount; i++) {
+        coefs[i] = first->coefs[i] + second->coefs[i];
+    }
+
+    result->count = count;
+    result->coefs = coefs;
+
+    return result;
+}
+
+polynomial_t *scale_polynomial(polynomial_t *p, double scale, polynomial_t *result) {
+    if (result == NULL) result = malloc(sizeof(polynomial_t));
+
+    uint32_t count = p->count;
+    double *coefs = malloc(sizeof(double) * count);
+    for (uint32_t i = 0; i < count; i++) {
+        coefs[i] = p->coefs[i] * scale;
+    }
+
+    result->count = count;
+    result->coefs = coefs;
+
+    return result;
+}
+
+polynomial_t *shift_polynomial(polynomial_t *p, uint32_t amount, polynomial_t *result) {
+    if (result == NULL) result = malloc(sizeof(polynomial_t));
+    uint32_t count = p->count + amount;
+    double *coefs = malloc(sizeof(double) * count);
+    memset(coefs, 0, sizeof(double) * amount);
+    memcpy(coefs+amount, p->coefs, sizeof(double) * p->count);
+    result->count = count;
+    result->coefs = coefs;
+    return result;
+}
+
+void expand_factored(factored_t *f, polynomial_t *result) {
+    if (f->count == 0) {
+        abort_("Cannot expand factored_t with no factors");
+    } else if (f->count == 1) {
+        uint32_t coef_count = f->factors->count;
+        result->count = coef_count;
+        size_t coef_mem = sizeof(double) * coef_count;
+        double *coefs = malloc(coef_mem);
+        memcpy(coefs, f->factors->coefs, coef_mem);
+        result->coefs = coefs;
+    } else {
+        *result = *f->factors;
+        for (uint32_t i = 1; i < f->count; i++) {
+            double *coefs_mem = result->coefs;
+            multiply_polynomials(result, &f->factors[i], result);
+            if (i >= 2) free(coefs_mem);
+        }
+    }
+}
+
+// result->polynomials must already have room for list.count
+void expand_factored_list(factored_list_t list, polynomial_list_t *result) {
+    polynomial_t *polynomials = result->polynomials;
+    result->count = list.count;
+    for (uint32_t i = 0; i < list.count; i++) {
+        expand_factored(&list.factoreds[i], &polynomials[i]);
+    }
+}
+
+uint64_t hash_polynomial(polynomial_t *p) {
+    // FNV-1a over the coefficient bytes, to agree with polynomial_eq
+    uint64_t hash = 14695981039346656037ull;
+    unsigned char *bytes = (unsigned char*)p->coefs;
+    for (size_t i = 0; i < sizeof(double) * p->count; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash ^ p->count;
+}
+
+// Drops every combo whose expansion shows up again later in the list,
+// keeping the order of the rest. Walks backwards through an open addressing
+// table of indices, so it stays linear in the 2^n combos.
+void dedup_factored_polynomial_lists(factored_list_t *f, polynomial_list_t *p, scratch_t *scratch) {
+    uint32_t count = f->count;
+
+    factored_t *fs = f->factoreds;
+    polynomial_t *ps = p->polynomials;
+
+    uint32_t table_size = 1;
+    while (table_size < 2 * count) table_size <<= 1;
+    uint32_t *table = reserve_scratch(&scratch->dedup_table, &scratch->dedup_table_cap, table_size, sizeof(uint32_t));
+    // slots hold index + 1, so zero is free
+    memset(table, 0, sizeof(uint32_t) * table_size);
+
+    for (uint32_t i = count; i-- > 0;) {
+        polynomial_t *polynomial = &ps[i];
+        uint32_t slot = hash_polynomial(polynomial) & (table_size - 1);
+        while (table[slot] != 0 && !polynomial_eq(polynomial, &ps[table[slot] - 1])) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] == 0) {
+            table[slot] = i + 1;
+        } else {
+            free(fs[i].factors);
+            free(polynomial->coefs);
+            polynomial->coefs = NULL;
+        }
+    }
+
+    uint32_t idx = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (ps[i].coefs == NULL) continue;
+        fs[idx] = fs[i];
+        ps[idx] = ps[i];
+        idx++;
+    }
+
+    f->count = idx;
+    p->count = idx;
+}
+
+uint32_t *create_numerator_powers(uint32_t row_count, factored_list_t fi, factored_list_t *fn, polynomial_list_t *pl, scratch_t *scratch) {
+    uint32_t *max_num_powers = reserve_scratch(&scratch->max_num_powers, &scratch->max_num_powers_cap, fi.count, sizeof(uint32_t));
+
+    uint32_t count = 0;
+    
+    for (uint32_t i = 0; i < fi.count; i++) {
+        uint32_t coef_count = polynomial_coef_count(&pl->polynomials[i]);
+        // only the proper remainder comes in, so the numerator power is
+        // bounded by the rows left above the combo, not by its own degree.
+        // row_count comes from the trimmed product of the factors, which a
+        // combo of small leading coefficients can outgrow
+        uint32_t max_num_power = 0;
+        if (coef_count <= row_count) max_num_power = row_count - coef_count;
+        max_num_powers[i] = max_num_power;
+        count += max_num_power + 1;
+    }
+
+    factored_t *fs = reserve_scratch(&scratch->powered_combos, &scratch->powered_combos_cap, count, sizeof(factored_t));
+    
+    polynomial_t *ps = reserve_scratch(&scratch->powered_polynomials, &scratch->powered_polynomials_cap, count, sizeof(polynomial_t));
+
+    uint32_t *powers = reserve_scratch(&scratch->powers, &scratch->powers_cap, count, sizeof(uint32_t));
+
+    uint32_t idx = 0;
+    for (uint32_t i = 0; i < fi.count; i++) {
+        factored_t factored = fi.factoreds[i];
+        polynomial_t polynomial = pl->polynomials[i];
+        uint32_t max_num_power = max_num_powers[i];
+        for (uint32_t power = 0; power <= max_num_power; (power++, idx++)) {
+            fs[idx] = factored;
+            shift_polynomial(&polynomial, power, &ps[idx]);
+            powers[idx] = power;
+        }
+        free(polynomial.coefs);
+    }
+
+    pl->polynomials = ps;
+    pl->count = count;
+
+    fn->factoreds = fs;
+    fn->count = count;
+
+    return powers;
+}
+
+void factored_over_factored(factored_t *factors, factored_t old, factored_t *new_) {
+    uint32_t count = factors->count - old.count;
+    new_->count = count;
+    polynomial_t *new_factors = malloc(sizeof(polynomial_t) * count);
+    new_->factors = new_factors;
+
+    uint32_t idx = 0;
+
+    char used_factors[factors->count];
+    memset(used_factors, 0, factors->count);
+    for (uint32_t j = 0; j < factors->count; j++) {
+        polynomial_t factor = factors->factors[j];
+        for (uint32_t k = 0; k < old.count; k++) {
+            if (used_factors[k]) continue;
+            polynomial_t old_factor = old.factors[k];
+            if (polynomial_eq(&old_factor, &factor)) {
+                used_factors[k] = 1;
+                goto not_included;
+            }
+        }
+
+        new_factors[idx++] = factor;
+
+not_included:;
+    }
+}
+
+// result->factoreds must already have room for list.count
+void factored_over_factored_list(factored_t *factors, factored_list_t list, factored_list_t *result) {
+    factored_t *factoreds = result->factoreds;
+    result->count = list.count;
+
+    for (uint32_t i = 0; i < list.count; i++) {
+        factored_over_factored(factors, list.factoreds[i], factoreds + i);
+    }
+}
+
+// The recursion of _all_factored_combos_recurse cut into tasks. A prefix
+// shorter than the split depth is a task emitting just itself, and a prefix
+// at the split depth emits its whole subtree, so the task outputs put back
+// together in task order match the serial order exactly.
+typedef struct {
+    uint32_t prefix[MAX_SPLIT_DEPTH];
+    uint32_t length;
+    int subtree;
+} combos_task_t;
+
+// Each pool worker appends to its own buffers
+typedef struct {
+    factored_list_t combos;
+    uint32_t combos_cap;
+    polynomial_list_t polynomials;
+    uint32_t polynomials_cap;
+} combos_buffer_t;
+
+// Where a task left its output
+typedef struct {
+    uint32_t worker;
+    uint32_t start;
+    uint32_t count;
+} combos_segment_t;
+
+typedef struct {
+    factored_t *factors;
+    combos_task_t *tasks;
+    combos_segment_t *segments;
+    combos_buffer_t *buffers;
+} combos_ctx_t;
+
+uint32_t _plan_combos_tasks(uint32_t factor_count, uint32_t split_depth, generic_list_t *tasks, uint32_t cap, combos_task_t *task, uint32_t length) {
+    uint32_t start = length > 0 ? task->prefix[length-1] + 1 : 0;
+    for (uint32_t j = start; j < factor_count; j++) {
+        task->prefix[length] = j;
+        task->length = length + 1;
+        int has_children = length + 1 < factor_count - 1;
+        task->subtree = length + 1 == split_depth || !has_children;
+        cap = list_append(tasks, cap, sizeof(combos_task_t), task);
+        if (!task->subtree) {
+            cap = _plan_combos_tasks(factor_count, split_depth, tasks, cap, task, length + 1);
+        }
+    }
+    return cap;
+}
+
+void run_combos_task(void *arg, uint32_t task_idx, uint32_t worker) {
+    combos_ctx_t *ctx = arg;
+    combos_task_t *task = &ctx->tasks[task_idx];
+    combos_buffer_t *buffer = &ctx->buffers[worker];
+    factored_t *factors = ctx->factors;
+
+    uint32_t start = buffer->combos.count;
+    uint32_t stack[factors->count];
+    uint32_t stack_count = task->length;
+    memcpy(stack, task->prefix, sizeof(uint32_t) * stack_count);
+    buffer->combos_cap = _all_factored_combos_append(
+        factors, &buffer->combos, buffer->combos_cap, stack, stack_count);
+    if (task->subtree && stack_count < factors->count - 1) {
+        buffer->combos_cap = _all_factored_combos_recurse(
+            factors, &buffer->combos, buffer->combos_cap, stack, &stack_count);
+    }
+    uint32_t end = buffer->combos.count;
+
+    // expanded here too, while the combos are still fresh
+    for (uint32_t i = start; i < end; i++) {
+        polynomial_t polynomial;
+        expand_factored(&buffer->combos.factoreds[i], &polynomial);
+        buffer->polynomials_cap = list_append((generic_list_t*)&buffer->polynomials,
+            buffer->polynomials_cap, sizeof(polynomial_t), &polynomial);
+    }
+
+    combos_segment_t segment = {worker, start, end - start};
+    ctx->segments[task_idx] = segment;
+}
+
+// generate_all_factored_combos followed by expand_factored_list, spread over
+// the pool when the denominator is wide enough for it to pay off. Both
+// output arrays must already have room for combo_count(factors->count).
+void generate_expanded_combos(factored_t *factors, task_pool_t *pool, factored_list_t *combos, polynomial_list_t *polynomials) {
+    if (pool == NULL || factors->count < PARALLEL_MIN_FACTORS) {
+        generate_all_factored_combos(factors, combos);
+        expand_factored_list(*combos, polynomials);
+        return;
+    }
+
+    // the biggest subtree at split depth d holds about 2^-d of the subsets,
+    // so aim for a few times more of those than there are workers
+    uint32_t split_depth = 1;
+    while (split_depth < MAX_SPLIT_DEPTH && split_depth < factors->count - 2
+        && (1u << split_depth) < 4 * pool->thread_count) {
+        split_depth++;
+    }
+
+    generic_list_t tasks = {NULL, 0};
+    combos_task_t task;
+    _plan_combos_tasks(factors->count, split_depth, &tasks, 0, &task, 0);
+
+    combos_ctx_t ctx;
+    ctx.factors = factors;
+    ctx.tasks = (combos_task_t*)tasks.items;
+    ctx.segments = malloc(sizeof(combos_segment_t) * tasks.count);
+    ctx.buffers = calloc(pool->thread_count, sizeof(combos_buffer_t));
+
+    run_tasks(pool, run_combos_task, &ctx, tasks.count);
+
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < tasks.count; i++) {
+        total += ctx.segments[i].count;
+    }
+    combos->count = total;
+    polynomials->count = total;
+
+    uint32_t idx = 0;
+    for (uint32_t i = 0; i < tasks.count; i++) {
+        combos_segment_t segment = ctx.segments[i];
+        combos_buffer_t *buffer = &ctx.buffers[segment.worker];
+        memcpy(combos->factoreds + idx, buffer->combos.factoreds + segment.start,
+            sizeof(factored_t) * segment.count);
+        memcpy(polynomials->polynomials + idx, buffer->polynomials.polynomials + segment.start,
+            sizeof(polynomial_t) * segment.count);
+        idx += segment.count;
+    }
+
+    for (uint32_t i = 0; i < pool->thread_count; i++) {
+        free(ctx.buffers[i].combos.factoreds);
+        free(ctx.buffers[i].polynomials.polynomials);
+    }
+    free(ctx.buffers);
+    free(ctx.segments);
+    free(tasks.items);
+}
+
+typedef struct {
+    factored_t *factors;
+    factored_list_t list;
+    factored_list_t *inverses;
+    polynomial_list_t *expanded;
+} inverses_ctx_t;
+
+void run_inverses_task(void *arg, uint32_t task, uint32_t worker) {
+    (void)worker;
+    inverses_ctx_t *ctx = arg;
+    uint32_t end = (task + 1) * INVERSES_PER_TASK;
+    if (end > ctx->list.count) end = ctx->list.count;
+    for (uint32_t i = task * INVERSES_PER_TASK; i < end; i++) {
+        factored_t *inverse = &ctx->inverses->factoreds[i];
+        factored_over_factored(ctx->factors, ctx->list.factoreds[i], inverse);
+        expand_factored(inverse, &ctx->expanded->polynomials[i]);
+    }
+}
+
+// factored_over_factored_list followed by expand_factored_list. Every item
+// has its own slot in the output arrays, which must already have room for
+// list.count, so blocks of them can go to the pool.
+void expand_inverses(factored_t *factors, factored_list_t list, task_pool_t *pool, factored_list_t *inverses, polynomial_list_t *expanded) {
+    if (pool == NULL || factors->count < PARALLEL_MIN_FACTORS) {
+        factored_over_factored_list(factors, list, inverses);
+        expand_factored_list(*inverses, expanded);
+        return;
+    }
+
+    inverses->count = list.count;
+    expanded->count = list.count;
+
+    inverses_ctx_t ctx = {factors, list, inverses, expanded};
+    uint32_t task_count = (list.count + INVERSES_PER_TASK - 1) / INVERSES_PER_TASK;
+    run_tasks(pool, run_inverses_task, &ctx, task_count);
+}
+
+// Schoolbook division. The remainder always gets one coefficient less than
+// the divisor, zero padded, so it lines up with the rows of the matrix.
+void divide_polynomials(polynomial_t *n, polynomial_t *d, polynomial_t *quotient, polynomial_t *remainder) {
+    uint32_t n_count = polynomial_coef_count(n);
+    // only exact zeros come off the divisor, so the remainder keeps one
+    // coefficient per unit of the denominator's real degree even when its
+    // leading coefficient falls under the is_zero tolerance
+    uint32_t d_count = d->count;
+    while (d_count > 0 && d->coefs[d_count-1] == 0) d_count--;
+    if (d_count < 2) abort_("Cannot divide by a constant polynomial");
+
+    uint32_t r_count = d_count - 1;
+    uint32_t q_count = n_count >= d_count ? n_count - d_count + 1 : 1;
+
+    double *r = calloc(1, sizeof(double) * (n_count > r_count ? n_count : r_count));
+    memcpy(r, n->coefs, sizeof(double) * n_count);
+    double *q = calloc(1, sizeof(double) * q_count);
+
+    if (n_count >= d_count) {
+        double lead = d->coefs[d_count-1];
+        for (uint32_t i = q_count; i-- > 0;) {
+            double coef = r[i + d_count - 1] / lead;
+            q[i] = coef;
+            for (uint32_t j = 0; j < d_count; j++) {
+                r[i + j] -= coef * d->coefs[j];
+            }
+        }
+    }
+
+    quotient->coefs = q;
+    quotient->count = q_count;
+    remainder->coefs = r;
+    remainder->count = r_count;
+}
+
+void make_matrix(double matrix[], uint32_t matrix_width, uint32_t matrix_height, polynomial_list_t polynomial_list, polynomial_t *numerator) {
+    for (uint32_t x = 0; x < matrix_width - 1; x++) {
+        double *cell_p = matrix + x;
+        polynomial_t polynomial = polynomial_list.polynomials[x];
+        uint32_t y = 0;
+        for (; y < polynomial.count; y++) {
+            *cell_p = polynomial.coefs[y];
+            cell_p += matrix_width;
+        }
+        for (; y < matrix_height; y++) {
+            *cell_p = 0;
+            cell_p += matrix_width;
+        }
+    }
+    double *right_p = matrix + (matrix_width - 1);
+    for (uint32_t y = 0; y < matrix_height; y++) {
+        *right_p = y < numerator->count ? numerator->coefs[y] : 0;
+        right_p += matrix_width;
+    }
+}
+
+int extract_leading_values(double matrix[], uint32_t matrix_width, uint32_t matrix_height, double multiples[], uint32_t polynomial_count) {
+    memset(multiples, 0, sizeof(double) * polynomial_count);
+    uint32_t x = 0;
+    double *row = matrix;
+    for (uint32_t y = 0; y < matrix_height; y++) {
+        double row_end = *(row + (matrix_width - 1));
+        for (; x < polynomial_count; x++) {
+            if (is_double_eq(*(row+x), 1)) {
+                multiples[x] = row_end;
+                goto found_leading;
+            }
+        }
+        if (!is_zero(row_end)) {
+            return 1;
+        }
+    found_leading:
+        row += matrix_width;
+    }
+    return 0;
+}
+
+void scale_polynomials(polynomial_list_t *polynomials, double multiples[]) {
+    for (uint32_t i = 0; i < polynomials->count; i++) {
+        polynomial_t *polynomial = &polynomials->polynomials[i];
+        double *old_coefs = polynomial->coefs;
+        scale_polynomial(polynomial, multiples[i], polynomial);
+        free(old_coefs);
+    }
+}
+
+void filter_zero_multiple_polynomial_list(polynomial_list_t *polynomials, double multiples[], uint32_t powers[]) {
+    uint32_t idx = 0;
+    for (uint32_t i = 0; i < polynomials->count; i++) {
+        polynomial_t polynomial = polynomials->polynomials[i];
+        double multiple = multiples[i];
+        if (is_zero(multiple)) {
+            free(polynomial.coefs);
+        } else {
+            multiples[idx] = multiple;
+            powers[idx] = powers[i];
+            polynomials->polynomials[idx] = polynomial; 
+            idx++;
+        }
+    }
+    polynomials->count = idx;
+}
+
+void scale_multiples(double c, double *multiples, uint32_t multiples_count) {
+    for (uint32_t i = 0; i < multiples_count; i++) {
+        multiples[i] *= c;
+    }
+}
+
+void print_decomposed_result(FILE *out, int is_first, polynomial_list_t polynomials, uint32_t *powers, double multiples[]) {
+    for (uint32_t i = 0; i < polynomials.count; i++) {
+        print_monomial(out, is_first && i == 0, multiples[i], powers[i]);
+        fprintf(out, "/(");
+        print_polynomial(out, &polynomials.polynomials[i]);
+        fprintf(out, ")");
+    }
+}
+
+// Drops the terms whose numerator is zero and scales the rest by c
+void scale_fractions(double c, polynomial_list_t *numerators, polynomial_list_t *denominators) {
+    uint32_t idx = 0;
+    for (uint32_t i = 0; i < numerators->count; i++) {
+        polynomial_t numerator = numerators->polynomials[i];
+        polynomial_t denominator = denominators->polynomials[i];
+        scale_polynomial(&numerator, c, &numerators->polynomials[idx]);
+        free(numerator.coefs);
+        if (polynomial_coef_count(&numerators->polynomials[idx]) == 0) {
+            free(numerators->polynomials[idx].coefs);
+            free(denominator.coefs);
+        } else {
+            denominators->polynomials[idx] = denominator;
+            idx++;
+        }
+    }
+    numerators->count = idx;
+    denominators->count = idx;
+}
+
+void print_fractions(FILE *out, int is_first, polynomial_list_t numerators, polynomial_list_t denominators) {
+    for (uint32_t i = 0; i < numerators.count; i++) {
+        polynomial_t *numerator = &numerators.polynomials[i];
+        uint32_t coef_count = polynomial_coef_count(numerator);
+        uint32_t nonzero = 0;
+        for (uint32_t j = 0; j < coef_count; j++) {
+            if (!is_zero(numerator->coefs[j])) nonzero++;
+        }
+        if (nonzero == 1) {
+            print_monomial(out, is_first && i == 0, numerator->coefs[coef_count-1], coef_count-1);
+        } else {
+            if (!(is_first && i == 0)) fprintf(out, " + ");
+            fprintf(out, "(");
+            print_polynomial(out, numerator);
+            fprintf(out, ")");
+        }
+        fprintf(out, "/(");
+        print_polynomial(out, &denominators.polynomials[i]);
+        fprintf(out, ")");
+    }
+}
+
+void init_scratch(scratch_t *scratch) {
+    memset(scratch, 0, sizeof(scratch_t));
+}
+
+void free_scratch(scratch_t *scratch) {
+    free(scratch->matrix);
+    free(scratch->multiples);
+    free(scratch->powers);
+    free(scratch->max_num_powers);
+    free(scratch->combos);
+    free(scratch->polynomials);
+    free(scratch->powered_combos);
+    free(scratch->powered_polynomials);
+    free(scratch->inverses);
+    free(scratch->inverse_polynomials);
+    free(scratch->dedup_table);
+    init_scratch(scratch);
+}
+
+void *reserve_scratch(void *buffer_p, uint32_t *cap, uint32_t count, size_t item_size) {
+    void **buffer = buffer_p;
+    if (count > *cap) {
+        *buffer = realloc(*buffer, item_size * count);
+        *cap = count;
+    }
+    return *buffer;
+}
+
+int parse_polynomial(const char **sp, char end, polynomial_t *result) {
+    generic_list_t coefs = {NULL, 0};
+    uint32_t cap = 0;
+    const char *s = *sp;
+    while (1) {
+        while (isspace((unsigned char)*s)) s++;
+        if (*s == end) break;
+        char *num_end;
+        double coef = strtod(s, &num_end);
+        if (num_end == s || !isfinite(coef)) {
+            free(coefs.items);
+            return 1;
+        }
+        cap = list_append(&coefs, cap, sizeof(double), &coef);
+        s = num_end;
+    }
+    if (coefs.count == 0) return 1;
+    *sp = s + 1;
+    result->coefs = (double*)coefs.items;
+    result->count = coefs.count;
+    uint32_t coef_count = polynomial_coef_count(result);
+    if (coef_count > 0) result->count = coef_count;
+    else result->count = 1;
+    return 0;
+}
+
+int parse_problem(const char *line, polynomial_t **numerator, factored_t **denominator) {
+    const char *s = line;
+    polynomial_t num;
+    if (parse_polynomial(&s, '/', &num)) return 1;
+
+    factored_t *den = calloc(1, sizeof(factored_t));
+    uint32_t cap = 0;
+    while (1) {
+        while (isspace((unsigned char)*s)) s++;
+        if (*s == '\0') break;
+        polynomial_t factor;
+        if (*s++ != '(' || parse_polynomial(&s, ')', &factor)) goto malformed;
+        if (polynomial_coef_count(&factor) == 0) {
+            free(factor.coefs);
+            goto malformed;
+        }
+        cap = list_append((generic_list_t*)den, cap, sizeof(polynomial_t), &factor);
+    }
+    if (den->count == 0) goto malformed;
+
+    *numerator = malloc(sizeof(polynomial_t));
+    **numerator = num;
+    *denominator = den;
+    return 0;
+
+malformed:
+    free(num.coefs);
+    free_factored(den);
+    return 1;
+}
+
+int decompose(polynomial_t *numerator, factored_t *denominator, double front_constant, int allow_power_numerators, scratch_t *scratch, FILE *out) {
+    // a constant denominator leaves nothing but the polynomial part
+    if (denominator->count == 0) {
+        polynomial_t scaled;
+        scale_polynomial(numerator, front_constant, &scaled);
+        if (polynomial_coef_count(&scaled) > 0) print_polynomial(out, &scaled);
+        else fprintf(out, "0");
+        free(scaled.coefs);
+        return 0;
+    }
+
+    // split off the polynomial part so only a proper fraction is left
+    polynomial_t expanded;
+    expand_factored(denominator, &expanded);
+    polynomial_t quotient;
+    polynomial_t remainder;
+    divide_polynomials(numerator, &expanded, &quotient, &remainder);
+    uint32_t degree = expanded.count - 1;
+    free(expanded.coefs);
+
+    // the quotient is only printed once the rest is known to have worked
+    double *unscaled_coefs = quotient.coefs;
+    scale_polynomial(&quotient, front_constant, &quotient);
+    free(unscaled_coefs);
+    int has_quotient = polynomial_coef_count(&quotient) > 0;
+
+    if (polynomial_coef_count(&remainder) == 0) {
+        if (has_quotient) print_polynomial(out, &quotient);
+        else fprintf(out, "0");
+        free(quotient.coefs);
+        free(remainder.coefs);
+        return 0;
+    }
+
+    polynomial_list_t residue_numerators;
+    residue_numerators.polynomials = reserve_scratch(&scratch->polynomials, &scratch->polynomials_cap, degree, sizeof(polynomial_t));
+    polynomial_list_t residue_denominators;
+    residue_denominators.polynomials = reserve_scratch(&scratch->inverse_polynomials, &scratch->inverse_polynomials_cap, degree, sizeof(polynomial_t));
+    if (!decompose_by_residues(&remainder, denominator, &residue_numerators, &residue_denominators)) {
+        scale_fractions(front_constant, &residue_numerators, &residue_denominators);
+        // the remainder is not zero, so losing every term to the tolerance
+        // means the residues went wrong; the ansatz gets a try instead
+        int found = residue_numerators.count > 0;
+        if (found) {
+            if (has_quotient) print_polynomial(out, &quotient);
+            print_fractions(out, !has_quotient, residue_numerators, residue_denominators);
+        }
+        clear_polynomial_list(residue_numerators);
+        clear_polynomial_list(residue_denominators);
+        if (found) {
+            free(quotient.coefs);
+            free(remainder.coefs);
+            return 0;
+        }
+    }
+
+    // a single factor the residues can't split is already the answer
+    if (denominator->count == 1) {
+        polynomial_t scaled;
+        scale_polynomial(&remainder, front_constant, &scaled);
+        if (has_quotient) print_polynomial(out, &quotient);
+        print_fractions(out, !has_quotient, (polynomial_list_t) {&scaled, 1}, (polynomial_list_t) {denominator->factors, 1});
+        free(scaled.coefs);
+        free(quotient.coefs);
+        free(remainder.coefs);
+        return 0;
+    }
+
+    if (denominator->count > MAX_ANSATZ_FACTORS) {
+        free(quotient.coefs);
+        free(remainder.coefs);
+        return 1;
+    }
+
+    uint32_t combos = combo_count(denominator->count);
+    factored_list_t factors_list;
+    factors_list.factoreds = reserve_scratch(&scratch->combos, &scratch->combos_cap, combos, sizeof(factored_t));
+    polynomial_list_t polynomial_list;
+    polynomial_list.polynomials = reserve_scratch(&scratch->polynomials, &scratch->polynomials_cap, combos, sizeof(polynomial_t));
+    generate_expanded_combos(denominator, scratch->pool, &factors_list, &polynomial_list);
+    dedup_factored_polynomial_lists(&factors_list, &polynomial_list, scratch);
+
+    factored_list_t new_factors_list;
+
+    // one row per coefficient of the remainder, which is proper
+    uint32_t row_count = remainder.count;
+    
+    uint32_t *powers;
+    if (allow_power_numerators) {
+        powers = create_numerator_powers(row_count, factors_list, &new_factors_list, &polynomial_list, scratch);
+    } else {
+        powers = reserve_scratch(&scratch->powers, &scratch->powers_cap, polynomial_list.count, sizeof(uint32_t));
+        memset(powers, 0, sizeof(uint32_t) * polynomial_list.count);
+        new_factors_list = factors_list;
+    }
+
+    uint32_t matrix_width = polynomial_list.count + 1;
+    uint32_t matrix_height = row_count;
+    for (uint32_t i = 0; i < polynomial_list.count; i++) {
+        uint32_t count = polynomial_list.polynomials[i].count;
+        if (count > matrix_height) matrix_height = count;
+    }
+
+    double *matrix = reserve_scratch(&scratch->matrix, &scratch->matrix_cap, matrix_width * matrix_height, sizeof(double));
+
+    make_matrix(matrix, matrix_width, matrix_height, polynomial_list, &remainder);
+
+    rref(matrix, matrix_width, matrix_height);
+
+    double *multiples = reserve_scratch(&scratch->multiples, &scratch->multiples_cap, polynomial_list.count, sizeof(double));
+
+    int inconsistent = extract_leading_values(matrix, matrix_width, matrix_height, multiples, polynomial_list.count);
+
+    if (!inconsistent) {
+        factored_list_t inverse_factors;
+        inverse_factors.factoreds = reserve_scratch(&scratch->inverses, &scratch->inverses_cap, new_factors_list.count, sizeof(factored_t));
+        polynomial_list_t inverse_polynomials;
+        inverse_polynomials.polynomials = reserve_scratch(&scratch->inverse_polynomials, &scratch->inverse_polynomials_cap, new_factors_list.count, sizeof(polynomial_t));
+        expand_inverses(denominator, new_factors_list, scratch->pool, &inverse_factors, &inverse_polynomials);
+
+        filter_zero_multiple_polynomial_list(&inverse_polynomials, multiples, powers);
+
+        scale_multiples(front_constant, multiples, inverse_polynomials.count);
+
+        // the remainder is not zero, so it needs at least one term
+        inconsistent = inverse_polynomials.count == 0;
+        if (!inconsistent) {
+            if (has_quotient) print_polynomial(out, &quotient);
+            print_decomposed_result(out, !has_quotient, inverse_polynomials, powers, multiples);
+        }
+
+        clear_factored_list_shallow(inverse_factors);
+        clear_polynomial_list(inverse_polynomials);
+    }
+
+    free(quotient.coefs);
+    free(remainder.coefs);
+
+    clear_factored_list_shallow(factors_list);
+    clear_polynomial_list(polynomial_list);
+
+    return inconsistent;
+}
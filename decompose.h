@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "pool.h"
+
+#ifndef DECOMPOSE_H
+#define DECOMPOSE_H
+
+// Fewer factors than this and the ansatz is built on the calling thread
+#define PARALLEL_MIN_FACTORS 10
+// The ansatz has a term for every subset of the factors, so past this many
+// it would take gigabytes; decompose gives up instead
+#define MAX_ANSATZ_FACTORS 16
+
+typedef struct {
+    char *items;
+    uint32_t count;
+} generic_list_t;
+
+typedef struct {
+    double *coefs;
+    uint32_t count;
+} polynomial_t;
+
+typedef struct {
+    polynomial_t *factors;
+    uint32_t count;
+} factored_t;
+
+typedef struct {
+    factored_t *factoreds;
+    uint32_t count;
+} factored_list_t;
+
+typedef struct {
+    polynomial_t *polynomials;
+    uint32_t count;
+} polynomial_list_t;
+
+// Buffers that only grow, so a caller decomposing many problems in a row
+// (such as a server worker) stops allocating the matrix and the ansatz lists
+// once they are large enough. The polynomials in the lists still get their
+// own coefficient arrays.
+typedef struct {
+    double *matrix;
+    uint32_t matrix_cap;
+    double *multiples;
+    uint32_t multiples_cap;
+    uint32_t *powers;
+    uint32_t powers_cap;
+    uint32_t *max_num_powers;
+    uint32_t max_num_powers_cap;
+    factored_t *combos;
+    uint32_t combos_cap;
+    polynomial_t *polynomials;
+    uint32_t polynomials_cap;
+    factored_t *powered_combos;
+    uint32_t powered_combos_cap;
+    polynomial_t *powered_polynomials;
+    uint32_t powered_polynomials_cap;
+    factored_t *inverses;
+    uint32_t inverses_cap;
+    polynomial_t *inverse_polynomials;
+    uint32_t inverse_polynomials_cap;
+    uint32_t *dedup_table;
+    uint32_t dedup_table_cap;
+    // shared, not owned; wide denominators build their ansatz on it if set
+    task_pool_t *pool;
+} scratch_t;
+
+void abort_(char *msg);
+
+void print_polynomial(FILE *out, polynomial_t *p);
+
+void print_factored(FILE *out, factored_t *f);
+
+uint32_t polynomial_coef_count(polynomial_t *p);
+
+int polynomial_eq(polynomial_t *a, polynomial_t *b);
+
+polynomial_t *multiply_polynomials(polynomial_t *a, polynomial_t *b, polynomial_t *result);
+
+// Leaves deg(d) coefficients in the remainder, zero padded
+void divide_polynomials(polynomial_t *n, polynomial_t *d, polynomial_t *quotient, polynomial_t *remainder);
+
+void free_list(generic_list_t *list);
+
+void free_factored(factored_t *factored);
+
+polynomial_t *make_polynomial(double coefs[], uint32_t count);
+
+factored_t *make_factored(polynomial_t *factors[], uint32_t count);
+
+double factor_out_constant(factored_t *f);
+
+void init_scratch(scratch_t *scratch);
+
+void free_scratch(scratch_t *scratch);
+
+// buffer_p points at one of the scratch_t buffers, which only ever grow
+void *reserve_scratch(void *buffer_p, uint32_t *cap, uint32_t count, size_t item_size);
+
+// Parses "375 -199 36 -2 / (0 1)(-5 1)(2)": numerator coefficients, then
+// each denominator factor in parentheses, all lowest power first
+int parse_problem(const char *line, polynomial_t **numerator, factored_t **denominator);
+
+// The denominator must already have had its constant factored out, which
+// is passed back in as front_constant. Returns nonzero if no decomposition
+// was found, in which case nothing is written to out.
+int decompose(polynomial_t *numerator, factored_t *denominator, double front_constant, int allow_power_numerators, scratch_t *scratch, FILE *out);
+
+#endif
@@ -0,0 +1,156 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "pool.h"
+
+typedef struct {
+    task_pool_t *pool;
+    uint32_t worker;
+} pool_worker_t;
+
+int take_own_task(task_deque_t *deque, uint32_t *task) {
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->top < deque->bottom) {
+        *task = --deque->bottom;
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+int steal_task(task_deque_t *deque, uint32_t *task) {
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->top < deque->bottom) {
+        *task = deque->top++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+// Nothing adds tasks during a batch, so once every deque is empty this
+// worker is done with it
+int next_task(task_pool_t *pool, uint32_t worker, uint32_t *task) {
+    if (take_own_task(&pool->deques[worker], task)) return 1;
+    for (uint32_t i = 1; i < pool->thread_count; i++) {
+        uint32_t victim = (worker + i) % pool->thread_count;
+        if (steal_task(&pool->deques[victim], task)) return 1;
+    }
+    return 0;
+}
+
+void *pool_worker_main(void *arg) {
+    pool_worker_t *self = arg;
+    task_pool_t *pool = self->pool;
+    uint32_t worker = self->worker;
+    free(self);
+
+    uint64_t seen_generation = 0;
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen_generation && !pool->stopping) {
+            pthread_cond_wait(&pool->start_cond, &pool->lock);
+        }
+        if (pool->stopping) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen_generation = pool->generation;
+        if (pool->remaining == 0) {
+            // woke too late, the batch is already over
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+        pool->active++;
+        task_fn_t fn = pool->fn;
+        void *ctx = pool->ctx;
+        pthread_mutex_unlock(&pool->lock);
+
+        uint32_t task;
+        uint32_t finished = 0;
+        while (next_task(pool, worker, &task)) {
+            fn(ctx, task, worker);
+            finished++;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        pool->remaining -= finished;
+        pool->active--;
+        if (pool->remaining == 0 && pool->active == 0) {
+            pthread_cond_signal(&pool->done_cond);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+task_pool_t *make_task_pool(uint32_t thread_count) {
+    task_pool_t *pool = calloc(1, sizeof(task_pool_t));
+    pool->thread_count = thread_count;
+    pool->threads = malloc(sizeof(pthread_t) * thread_count);
+    pool->deques = calloc(thread_count, sizeof(task_deque_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    pthread_mutex_init(&pool->submit_lock, NULL);
+    for (uint32_t i = 0; i < thread_count; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool_worker_t *self = malloc(sizeof(pool_worker_t));
+        self->pool = pool;
+        self->worker = i;
+        pthread_create(&pool->threads[i], NULL, pool_worker_main, self);
+    }
+    return pool;
+}
+
+void free_task_pool(task_pool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+    pthread_mutex_destroy(&pool->submit_lock);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
+
+void run_tasks(task_pool_t *pool, task_fn_t fn, void *ctx, uint32_t task_count) {
+    if (task_count == 0) return;
+    pthread_mutex_lock(&pool->submit_lock);
+
+    // a worker picks up fn and the filled deques together, under the pool
+    // lock, so one waking late can't run this batch's tasks with the old fn
+    pthread_mutex_lock(&pool->lock);
+
+    // each worker starts with a contiguous block, later ones a little larger
+    uint32_t thread_count = pool->thread_count;
+    for (uint32_t i = 0; i < thread_count; i++) {
+        task_deque_t *deque = &pool->deques[i];
+        pthread_mutex_lock(&deque->lock);
+        deque->top = (uint64_t)task_count * i / thread_count;
+        deque->bottom = (uint64_t)task_count * (i + 1) / thread_count;
+        pthread_mutex_unlock(&deque->lock);
+    }
+
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->remaining = task_count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+    // waiting for active too keeps a worker still scanning the deques for
+    // this batch from stealing a task of the next one
+    while (pool->remaining > 0 || pool->active > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&pool->submit_lock);
+}
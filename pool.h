@@ -0,0 +1,43 @@
+#include <pthread.h>
+#include <stdint.h>
+
+#ifndef POOL_H
+#define POOL_H
+
+typedef void (*task_fn_t)(void *ctx, uint32_t task, uint32_t worker);
+
+// The tasks of a batch not yet started by one worker, [top, bottom). The
+// owner takes from the bottom and idle workers steal from the top.
+typedef struct {
+    uint32_t top;
+    uint32_t bottom;
+    pthread_mutex_t lock;
+} task_deque_t;
+
+typedef struct {
+    uint32_t thread_count;
+    pthread_t *threads;
+    task_deque_t *deques;
+    task_fn_t fn;
+    void *ctx;
+    uint32_t remaining;
+    // workers still inside the current batch
+    uint32_t active;
+    uint64_t generation;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    // one batch at a time; other callers wait their turn
+    pthread_mutex_t submit_lock;
+} task_pool_t;
+
+task_pool_t *make_task_pool(uint32_t thread_count);
+
+void free_task_pool(task_pool_t *pool);
+
+// Calls fn once for each task in [0, task_count) across the pool, passing
+// the index of the worker running it, and returns when all have finished
+void run_tasks(task_pool_t *pool, task_fn_t fn, void *ctx, uint32_t task_count);
+
+#endif
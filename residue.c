@@ -0,0 +1,264 @@
+#include <complex.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "decompose.h"
+#include "residue.h"
+
+typedef struct {
+    double complex root;
+    uint32_t multiplicity;
+    // index into the distinct factors the root came from
+    uint32_t factor;
+} root_t;
+
+typedef struct {
+    // trimmed to its real degree, sharing the caller's coefficients
+    polynomial_t polynomial;
+    uint32_t multiplicity;
+} distinct_factor_t;
+
+int roots_eq(double complex a, double complex b) {
+    return cabs(a - b) <= 1e-9 * (1 + cabs(a));
+}
+
+// Returns nonzero if the root is already owned by a different factor, which
+// would leave no single factor to put its terms over
+int add_root(root_t roots[], uint32_t *count, double complex root, uint32_t multiplicity, uint32_t factor) {
+    for (uint32_t i = 0; i < *count; i++) {
+        if (roots_eq(roots[i].root, root)) {
+            if (roots[i].factor != factor) return 1;
+            roots[i].multiplicity += multiplicity;
+            return 0;
+        }
+    }
+    roots[*count].root = root;
+    roots[*count].multiplicity = multiplicity;
+    roots[*count].factor = factor;
+    (*count)++;
+    return 0;
+}
+
+// Writes the two roots of a x² + b x + c
+void quadratic_roots(double a, double b, double c, double complex roots[2]) {
+    double disc = b*b - 4*a*c;
+    // a perfect square typed with inexact coefficients (0.01 0.2 1) leaves
+    // rounding noise in disc, which would otherwise split its double root
+    // into two nearly equal ones with huge, cancelling residues
+    if (fabs(disc) <= 1e-12 * (b*b + fabs(4*a*c))) {
+        roots[0] = roots[1] = -b / (2*a);
+    } else if (disc > 0) {
+        // avoids cancellation between -b and the root of disc
+        double q = -(b + copysign(sqrt(disc), b)) / 2;
+        roots[0] = q / a;
+        roots[1] = c / q;
+    } else {
+        double re = -b / (2*a);
+        double im = sqrt(-disc) / (2*fabs(a));
+        roots[0] = CMPLX(re, im);
+        roots[1] = CMPLX(re, -im);
+    }
+}
+
+// Groups equal factors and finds the roots of each. Returns the leading
+// coefficient of the denominator, or 0 if some factor has a degree above two
+// or two different factors share a root
+double find_roots(factored_t *denominator, distinct_factor_t factors[], uint32_t *factor_count, root_t roots[], uint32_t *root_count) {
+    double lead = 1;
+    *factor_count = 0;
+    *root_count = 0;
+    for (uint32_t i = 0; i < denominator->count; i++) {
+        polynomial_t *factor = &denominator->factors[i];
+        polynomial_t trimmed = {factor->coefs, polynomial_coef_count(factor)};
+        if (trimmed.count > 3) return 0;
+        lead *= trimmed.coefs[trimmed.count-1];
+        if (trimmed.count == 1) continue;
+
+        uint32_t idx = 0;
+        while (idx < *factor_count && !polynomial_eq(&factors[idx].polynomial, &trimmed)) idx++;
+        if (idx == *factor_count) {
+            factors[idx].polynomial = trimmed;
+            factors[idx].multiplicity = 0;
+            (*factor_count)++;
+        }
+        factors[idx].multiplicity++;
+    }
+
+    for (uint32_t i = 0; i < *factor_count; i++) {
+        double *coefs = factors[i].polynomial.coefs;
+        uint32_t m = factors[i].multiplicity;
+        double complex factor_roots[2];
+        uint32_t factor_root_count = factors[i].polynomial.count - 1;
+        if (factor_root_count == 1) {
+            factor_roots[0] = -coefs[0] / coefs[1];
+        } else {
+            quadratic_roots(coefs[2], coefs[1], coefs[0], factor_roots);
+        }
+        for (uint32_t j = 0; j < factor_root_count; j++) {
+            if (add_root(roots, root_count, factor_roots[j], m, i)) return 0;
+        }
+    }
+    return lead;
+}
+
+// Multiplies series a by series b in place, keeping the first n terms
+void multiply_series(double complex a[], double complex b[], uint32_t n) {
+    for (uint32_t i = n; i-- > 0;) {
+        double complex sum = 0;
+        for (uint32_t j = 0; j <= i; j++) {
+            sum += a[j] * b[i-j];
+        }
+        a[i] = sum;
+    }
+}
+
+// Writes the first n Taylor coefficients of p around at into result
+void taylor_coefs(polynomial_t *p, double complex at, double complex result[], uint32_t n) {
+    uint32_t count = p->count;
+    double complex shifted[count];
+    for (uint32_t i = 0; i < count; i++) shifted[i] = p->coefs[i];
+    for (uint32_t i = 0; i < n; i++) {
+        if (i >= count) {
+            result[i] = 0;
+            continue;
+        }
+        for (uint32_t j = count - 1; j > i; j--) {
+            shifted[j-1] += at * shifted[j];
+        }
+        result[i] = shifted[i];
+    }
+}
+
+// The coefficients of c_k/(x-r)^k for k = 1..m, as coefs[k-1], found by
+// expanding the rest of the fraction as a series around r
+void root_coefs(polynomial_t *numerator, double lead, root_t roots[], uint32_t root_count, uint32_t j, double complex coefs[]) {
+    double complex r = roots[j].root;
+    uint32_t m = roots[j].multiplicity;
+
+    double complex series[m];
+    taylor_coefs(numerator, r, series, m);
+    for (uint32_t i = 0; i < m; i++) series[i] /= lead;
+
+    double complex inverse[m];
+    for (uint32_t i = 0; i < root_count; i++) {
+        if (i == j) continue;
+        // 1/(t + d) around t = 0 is the sum of (-1)^n t^n / d^(n+1)
+        double complex d = r - roots[i].root;
+        double complex term = 1 / d;
+        for (uint32_t n = 0; n < m; n++) {
+            inverse[n] = term;
+            term /= -d;
+        }
+        for (uint32_t k = 0; k < roots[i].multiplicity; k++) {
+            multiply_series(series, inverse, m);
+        }
+    }
+
+    for (uint32_t k = 1; k <= m; k++) {
+        coefs[k-1] = series[m-k];
+    }
+}
+
+// Multiplies the count coefficients of p by (x - r) in place, p needs room
+// for one more
+void multiply_linear(double complex p[], uint32_t count, double complex r) {
+    p[count] = 0;
+    for (uint32_t i = count; i > 0; i--) {
+        p[i] = p[i-1] - r * p[i];
+    }
+    p[0] *= -r;
+}
+
+void power_polynomial(polynomial_t *base, uint32_t power, polynomial_t *result) {
+    result->coefs = malloc(sizeof(double));
+    result->coefs[0] = 1;
+    result->count = 1;
+    for (uint32_t i = 0; i < power; i++) {
+        double *coefs_mem = result->coefs;
+        multiply_polynomials(result, base, result);
+        free(coefs_mem);
+    }
+}
+
+void append_term(polynomial_list_t *numerators, polynomial_list_t *denominators, polynomial_t numerator, polynomial_t *factor, uint32_t power) {
+    uint32_t idx = numerators->count++;
+    numerators->polynomials[idx] = numerator;
+    power_polynomial(factor, power, &denominators->polynomials[idx]);
+    denominators->count = numerators->count;
+}
+
+// Puts c_k/(x-r)^k for every root r of the factor f over f^M, where M is
+// how often f divides the denominator, then splits the sum back up into
+// N_k/f^k terms with deg(N_k) < deg(f), highest power first. The imaginary
+// parts cancel between conjugate roots.
+void append_factor_terms(distinct_factor_t *factor, uint32_t factor_idx, polynomial_t *numerator, double lead, root_t roots[], uint32_t root_count, polynomial_list_t *numerators, polynomial_list_t *denominators) {
+    polynomial_t *f = &factor->polynomial;
+    uint32_t power = factor->multiplicity;
+    uint32_t count = (f->count - 1) * power;
+
+    double f_lead_power = 1;
+    for (uint32_t i = 0; i < power; i++) f_lead_power *= f->coefs[f->count-1];
+
+    double complex sum[count];
+    memset(sum, 0, sizeof(sum));
+    for (uint32_t j = 0; j < root_count; j++) {
+        if (roots[j].factor != factor_idx) continue;
+        double complex r = roots[j].root;
+        uint32_t m = roots[j].multiplicity;
+
+        double complex coefs[m];
+        root_coefs(numerator, lead, roots, root_count, j, coefs);
+
+        // f^M/(x-r)^m, which (x-r) is multiplied back into for lower k
+        double complex base[count + 1];
+        base[0] = f_lead_power;
+        uint32_t base_count = 1;
+        for (uint32_t i = 0; i < root_count; i++) {
+            if (i == j || roots[i].factor != factor_idx) continue;
+            for (uint32_t n = 0; n < roots[i].multiplicity; n++) {
+                multiply_linear(base, base_count++, roots[i].root);
+            }
+        }
+        for (uint32_t k = m; k > 0; k--) {
+            for (uint32_t i = 0; i < base_count; i++) {
+                sum[i] += coefs[k-1] * base[i];
+            }
+            if (k > 1) multiply_linear(base, base_count++, r);
+        }
+    }
+
+    polynomial_t rest = {malloc(sizeof(double) * count), count};
+    for (uint32_t i = 0; i < count; i++) rest.coefs[i] = creal(sum[i]);
+    for (uint32_t k = power; k > 0; k--) {
+        polynomial_t quotient;
+        polynomial_t remainder;
+        divide_polynomials(&rest, f, &quotient, &remainder);
+        append_term(numerators, denominators, remainder, f, k);
+        free(rest.coefs);
+        rest = quotient;
+    }
+    free(rest.coefs);
+}
+
+int decompose_by_residues(polynomial_t *numerator, factored_t *denominator, polynomial_list_t *numerators, polynomial_list_t *denominators) {
+    uint32_t degree = 0;
+    for (uint32_t i = 0; i < denominator->count; i++) {
+        degree += polynomial_coef_count(&denominator->factors[i]) - 1;
+    }
+
+    distinct_factor_t factors[denominator->count];
+    uint32_t factor_count;
+    root_t roots[degree];
+    uint32_t root_count;
+    double lead = find_roots(denominator, factors, &factor_count, roots, &root_count);
+    if (lead == 0) return 1;
+
+    numerators->count = 0;
+    denominators->count = 0;
+    for (uint32_t i = 0; i < factor_count; i++) {
+        append_factor_terms(&factors[i], i, numerator, lead, roots, root_count, numerators, denominators);
+    }
+
+    return 0;
+}
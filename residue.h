@@ -0,0 +1,16 @@
+#include <stdint.h>
+#include "decompose.h"
+
+#ifndef RESIDUE_H
+#define RESIDUE_H
+
+// Decomposes a proper fraction whose denominator factors all have degree
+// two or less, without building a matrix. Roots are found in the complex
+// plane and the terms of each factor's roots are recombined into real
+// N/f^k terms over powers of that factor as given, leading coefficient
+// and all. numerators and denominators need room for deg(denominator)
+// entries. Returns nonzero, touching nothing, if some factor has a higher
+// degree or two different factors share a root.
+int decompose_by_residues(polynomial_t *numerator, factored_t *denominator, polynomial_list_t *numerators, polynomial_list_t *denominators);
+
+#endif
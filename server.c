@@ -0,0 +1,442 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "decompose.h"
+#include "server.h"
+
+// Requests a single connection may have parsed but not yet written back;
+// once a client gets this far ahead its reader stops reading
+#define WINDOW 64
+#define LATENCY_BUCKETS 32
+
+enum {JOB_DECOMPOSE, JOB_MALFORMED, JOB_TOO_WIDE, JOB_STATS};
+
+struct conn_t;
+
+typedef struct job_t {
+    struct job_t *next;
+    struct conn_t *conn;
+    int kind;
+    polynomial_t *numerator;
+    factored_t *denominator;
+    struct timespec received;
+    char *response;
+    uint32_t response_len;
+    uint32_t response_cap;
+    int done;
+} job_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t failed;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    // bucket i counts latencies below 2^i microseconds
+    uint64_t buckets[LATENCY_BUCKETS];
+    pthread_mutex_t lock;
+} stats_t;
+
+typedef struct {
+    job_t *first;
+    job_t *last;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    stats_t stats;
+    // for the few requests wide enough to split up further, so only
+    // started by the first of them
+    task_pool_t *pool;
+    long pool_threads;
+    pthread_mutex_t pool_lock;
+} server_t;
+
+typedef struct conn_t {
+    server_t *server;
+    FILE *in;
+    int out_fd;
+    job_t jobs[WINDOW];
+    // head is the next job to write back, tail the next slot to fill
+    uint32_t head;
+    uint32_t tail;
+    int eof;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} conn_t;
+
+volatile sig_atomic_t interrupted = 0;
+
+uint64_t elapsed_ns(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000
+        + now.tv_nsec - start->tv_nsec;
+}
+
+void record_latency(stats_t *stats, uint64_t ns, int failed) {
+    uint32_t bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && (ns / 1000) >> bucket) bucket++;
+
+    pthread_mutex_lock(&stats->lock);
+    if (stats->count == 0 || ns < stats->min_ns) stats->min_ns = ns;
+    if (ns > stats->max_ns) stats->max_ns = ns;
+    stats->count++;
+    stats->failed += failed;
+    stats->total_ns += ns;
+    stats->buckets[bucket]++;
+    pthread_mutex_unlock(&stats->lock);
+}
+
+uint64_t latency_percentile_us(stats_t *stats, double fraction) {
+    if (stats->count == 0) return 0;
+    uint64_t target = stats->count * fraction;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += stats->buckets[i];
+        if (seen > target) return (uint64_t)1 << i;
+    }
+    return (uint64_t)1 << (LATENCY_BUCKETS - 1);
+}
+
+void print_stats(FILE *out, stats_t *stats) {
+    pthread_mutex_lock(&stats->lock);
+    uint64_t count = stats->count;
+    uint64_t mean_us = count ? stats->total_ns / count / 1000 : 0;
+    fprintf(out, "requests %" PRIu64 " failed %" PRIu64 " latency_us min %" PRIu64
+        " mean %" PRIu64 " p50<%" PRIu64 " p99<%" PRIu64 " max %" PRIu64,
+        count, stats->failed, stats->min_ns / 1000, mean_us,
+        latency_percentile_us(stats, 0.5), latency_percentile_us(stats, 0.99),
+        stats->max_ns / 1000);
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void push_job(server_t *server, job_t *job) {
+    job->next = NULL;
+    pthread_mutex_lock(&server->lock);
+    if (server->last) server->last->next = job;
+    else server->first = job;
+    server->last = job;
+    pthread_cond_signal(&server->cond);
+    pthread_mutex_unlock(&server->lock);
+}
+
+job_t *pop_job(server_t *server) {
+    pthread_mutex_lock(&server->lock);
+    while (!server->first && !server->stopping) {
+        pthread_cond_wait(&server->cond, &server->lock);
+    }
+    job_t *job = server->first;
+    if (job) {
+        server->first = job->next;
+        if (!server->first) server->last = NULL;
+    }
+    pthread_mutex_unlock(&server->lock);
+    return job;
+}
+
+task_pool_t *server_pool(server_t *server) {
+    pthread_mutex_lock(&server->pool_lock);
+    if (server->pool == NULL) server->pool = make_task_pool(server->pool_threads);
+    task_pool_t *pool = server->pool;
+    pthread_mutex_unlock(&server->pool_lock);
+    return pool;
+}
+
+void run_job(job_t *job, scratch_t *scratch, FILE *out) {
+    if (job->kind == JOB_MALFORMED) {
+        fprintf(out, "error: malformed request");
+    } else if (job->kind == JOB_TOO_WIDE) {
+        fprintf(out, "error: more than %d denominator factors", MAX_ANSATZ_FACTORS);
+    } else {
+        double front_constant = 1/factor_out_constant(job->denominator);
+        if (job->denominator->count >= PARALLEL_MIN_FACTORS) {
+            scratch->pool = server_pool(job->conn->server);
+        }
+        if (decompose(job->numerator, job->denominator, front_constant, 1, scratch, out)) {
+            fprintf(out, "error: can't find the partial fraction decomposition");
+        }
+        free_list((generic_list_t*)job->numerator);
+        free_factored(job->denominator);
+    }
+    fprintf(out, "\n");
+}
+
+void *worker_main(void *arg) {
+    server_t *server = arg;
+
+    // everything here stays allocated across requests
+    scratch_t scratch;
+    init_scratch(&scratch);
+    char *out_buf = NULL;
+    size_t out_size = 0;
+    FILE *out = open_memstream(&out_buf, &out_size);
+
+    job_t *job;
+    while ((job = pop_job(server))) {
+        rewind(out);
+        run_job(job, &scratch, out);
+        fflush(out);
+        uint32_t len = ftell(out);
+
+        if (len > job->response_cap) {
+            job->response = realloc(job->response, len);
+            job->response_cap = len;
+        }
+        memcpy(job->response, out_buf, len);
+        job->response_len = len;
+
+        conn_t *conn = job->conn;
+        pthread_mutex_lock(&conn->lock);
+        job->done = 1;
+        pthread_cond_broadcast(&conn->cond);
+        pthread_mutex_unlock(&conn->lock);
+    }
+
+    fclose(out);
+    free(out_buf);
+    free_scratch(&scratch);
+    return NULL;
+}
+
+int write_all(int fd, char *buf, uint32_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        buf += written;
+        len -= written;
+    }
+    return 0;
+}
+
+void *writer_main(void *arg) {
+    conn_t *conn = arg;
+    int broken = 0;
+    while (1) {
+        pthread_mutex_lock(&conn->lock);
+        while (conn->head == conn->tail ? !conn->eof : !conn->jobs[conn->head % WINDOW].done) {
+            pthread_cond_wait(&conn->cond, &conn->lock);
+        }
+        if (conn->head == conn->tail) {
+            pthread_mutex_unlock(&conn->lock);
+            break;
+        }
+        pthread_mutex_unlock(&conn->lock);
+
+        // the slot can't be reused until head moves past it
+        job_t *job = &conn->jobs[conn->head % WINDOW];
+        if (job->kind == JOB_STATS) {
+            // built only now, so every earlier response is already counted
+            char *stats_buf = NULL;
+            size_t stats_size = 0;
+            FILE *out = open_memstream(&stats_buf, &stats_size);
+            print_stats(out, &conn->server->stats);
+            fprintf(out, "\n");
+            fclose(out);
+            free(job->response);
+            job->response = stats_buf;
+            job->response_len = stats_size;
+            job->response_cap = stats_size;
+        }
+        // after a failed write keep draining so the reader never stalls
+        if (!broken) broken = write_all(conn->out_fd, job->response, job->response_len);
+        int failed = job->response_len >= 6 && memcmp(job->response, "error:", 6) == 0;
+        if (job->kind != JOB_STATS) {
+            record_latency(&conn->server->stats, elapsed_ns(&job->received), failed);
+        }
+
+        pthread_mutex_lock(&conn->lock);
+        conn->head++;
+        pthread_cond_broadcast(&conn->cond);
+        pthread_mutex_unlock(&conn->lock);
+    }
+    return NULL;
+}
+
+void serve_connection(server_t *server, FILE *in, int out_fd) {
+    conn_t *conn = calloc(1, sizeof(conn_t));
+    conn->server = server;
+    conn->in = in;
+    conn->out_fd = out_fd;
+    pthread_mutex_init(&conn->lock, NULL);
+    pthread_cond_init(&conn->cond, NULL);
+
+    pthread_t writer;
+    pthread_create(&writer, NULL, writer_main, conn);
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t line_len;
+    while ((line_len = getline(&line, &line_cap, in)) >= 0) {
+        while (line_len > 0 && (line[line_len-1] == '\n' || line[line_len-1] == '\r')) {
+            line[--line_len] = '\0';
+        }
+        if (line_len == 0) continue;
+
+        pthread_mutex_lock(&conn->lock);
+        while (conn->tail - conn->head == WINDOW) {
+            pthread_cond_wait(&conn->cond, &conn->lock);
+        }
+        pthread_mutex_unlock(&conn->lock);
+
+        // nobody else looks at the slot until tail moves past it
+        job_t *job = &conn->jobs[conn->tail % WINDOW];
+        clock_gettime(CLOCK_MONOTONIC, &job->received);
+        job->conn = conn;
+        job->done = 0;
+        if (strcmp(line, "stats") == 0) {
+            // the writer fills these in itself once it gets to them
+            job->kind = JOB_STATS;
+            job->done = 1;
+        } else if (parse_problem(line, &job->numerator, &job->denominator)) {
+            job->kind = JOB_MALFORMED;
+        } else if (job->denominator->count > MAX_ANSATZ_FACTORS) {
+            // turned away here so one line can't tie up a worker and the
+            // shared pool building 2^n subsets
+            job->kind = JOB_TOO_WIDE;
+            free_list((generic_list_t*)job->numerator);
+            free_factored(job->denominator);
+        } else {
+            job->kind = JOB_DECOMPOSE;
+        }
+
+        pthread_mutex_lock(&conn->lock);
+        conn->tail++;
+        pthread_cond_broadcast(&conn->cond);
+        pthread_mutex_unlock(&conn->lock);
+
+        if (job->kind != JOB_STATS) push_job(server, job);
+    }
+    free(line);
+
+    pthread_mutex_lock(&conn->lock);
+    conn->eof = 1;
+    pthread_cond_broadcast(&conn->cond);
+    pthread_mutex_unlock(&conn->lock);
+
+    pthread_join(writer, NULL);
+
+    for (uint32_t i = 0; i < WINDOW; i++) {
+        free(conn->jobs[i].response);
+    }
+    pthread_cond_destroy(&conn->cond);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn);
+}
+
+typedef struct {
+    server_t *server;
+    int fd;
+} accepted_t;
+
+void *connection_main(void *arg) {
+    accepted_t accepted = *(accepted_t*)arg;
+    free(arg);
+    FILE *in = fdopen(accepted.fd, "r");
+    serve_connection(accepted.server, in, accepted.fd);
+    fclose(in);
+    return NULL;
+}
+
+void handle_interrupt(int signal) {
+    (void)signal;
+    interrupted = 1;
+}
+
+int listen_on(server_t *server, char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long\n");
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if (listen_fd < 0
+        || bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+        || listen(listen_fd, 64) < 0) {
+        perror("listen");
+        return 1;
+    }
+
+    // no SA_RESTART so accept returns once we are told to stop
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_interrupt;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    while (!interrupted) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        accepted_t *accepted = malloc(sizeof(accepted_t));
+        accepted->server = server;
+        accepted->fd = fd;
+        pthread_t thread;
+        pthread_create(&thread, NULL, connection_main, accepted);
+        pthread_detach(thread);
+    }
+
+    close(listen_fd);
+    unlink(socket_path);
+    return 0;
+}
+
+int serve(server_options_t *options) {
+    signal(SIGPIPE, SIG_IGN);
+
+    server_t server;
+    memset(&server, 0, sizeof(server));
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.cond, NULL);
+    pthread_mutex_init(&server.stats.lock, NULL);
+    pthread_mutex_init(&server.pool_lock, NULL);
+    server.pool_threads = options->worker_count;
+
+    pthread_t workers[options->worker_count];
+    for (long i = 0; i < options->worker_count; i++) {
+        pthread_create(&workers[i], NULL, worker_main, &server);
+    }
+
+    int result = 0;
+    if (options->socket_path) {
+        result = listen_on(&server, options->socket_path);
+        // connections still open when we were interrupted die with the process
+        print_stats(stderr, &server.stats);
+        fprintf(stderr, "\n");
+        return result;
+    }
+
+    serve_connection(&server, stdin, STDOUT_FILENO);
+
+    pthread_mutex_lock(&server.lock);
+    server.stopping = 1;
+    pthread_cond_broadcast(&server.cond);
+    pthread_mutex_unlock(&server.lock);
+    for (long i = 0; i < options->worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    if (server.pool != NULL) free_task_pool(server.pool);
+
+    print_stats(stderr, &server.stats);
+    fprintf(stderr, "\n");
+    return result;
+}
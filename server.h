@@ -0,0 +1,12 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+typedef struct {
+    // NULL serves a single session on stdin/stdout instead of a socket
+    char *socket_path;
+    long worker_count;
+} server_options_t;
+
+int serve(server_options_t *options);
+
+#endif
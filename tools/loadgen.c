@@ -0,0 +1,178 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Drives a server started with `main --server --socket path`: every
+// connection keeps up to depth requests in flight and times each response
+
+const char *problems[] = {
+    "375 -199 36 -2 / (0 1)(-5 1)(-5 1)(-5 1)(2)",
+    "1 / (-1 1)(-2 1)",
+    "3 0 1 / (1 0 1)(-1 1)(-1 1)",
+    "5 -4 1 / (0 1)(0 1)(3 1)(-2 1)",
+};
+#define PROBLEM_COUNT (sizeof(problems) / sizeof(problems[0]))
+
+typedef struct {
+    char *socket_path;
+    uint32_t requests;
+    uint32_t depth;
+    int fd;
+    struct timespec *sent;
+    uint64_t *latencies_ns;
+    uint32_t in_flight;
+    uint32_t failed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} client_t;
+
+void abort_(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+uint64_t elapsed_ns(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000
+        + now.tv_nsec - start->tv_nsec;
+}
+
+int connect_to(char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        exit(1);
+    }
+    return fd;
+}
+
+void *sender_main(void *arg) {
+    client_t *client = arg;
+    for (uint32_t i = 0; i < client->requests; i++) {
+        pthread_mutex_lock(&client->lock);
+        while (client->in_flight == client->depth) {
+            pthread_cond_wait(&client->cond, &client->lock);
+        }
+        client->in_flight++;
+        // the receiver reads this under the same lock
+        clock_gettime(CLOCK_MONOTONIC, &client->sent[i]);
+        pthread_mutex_unlock(&client->lock);
+
+        const char *problem = problems[i % PROBLEM_COUNT];
+        uint32_t len = strlen(problem);
+        char line[len + 1];
+        memcpy(line, problem, len);
+        line[len] = '\n';
+
+        char *buf = line;
+        uint32_t left = len + 1;
+        while (left > 0) {
+            ssize_t written = write(client->fd, buf, left);
+            if (written < 0) abort_("write to server failed");
+            buf += written;
+            left -= written;
+        }
+    }
+    shutdown(client->fd, SHUT_WR);
+    return NULL;
+}
+
+void *client_main(void *arg) {
+    client_t *client = arg;
+    client->fd = connect_to(client->socket_path);
+
+    pthread_t sender;
+    pthread_create(&sender, NULL, sender_main, client);
+
+    FILE *in = fdopen(client->fd, "r");
+    char *line = NULL;
+    size_t line_cap = 0;
+    uint32_t received = 0;
+    while (received < client->requests && getline(&line, &line_cap, in) >= 0) {
+        if (strncmp(line, "error:", 6) == 0) client->failed++;
+
+        pthread_mutex_lock(&client->lock);
+        // responses come back in request order
+        client->latencies_ns[received] = elapsed_ns(&client->sent[received]);
+        received++;
+        client->in_flight--;
+        pthread_cond_signal(&client->cond);
+        pthread_mutex_unlock(&client->lock);
+    }
+    if (received < client->requests) abort_("server closed the connection early");
+
+    pthread_join(sender, NULL);
+    free(line);
+    fclose(in);
+    return NULL;
+}
+
+int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(uint64_t*)a;
+    uint64_t y = *(uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+void usage(char *name) {
+    fprintf(stderr, "usage: %s socket [requests per connection] [connections] [depth]\n", name);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 5) usage(argv[0]);
+    uint32_t requests = argc > 2 ? atoi(argv[2]) : 10000;
+    uint32_t connections = argc > 3 ? atoi(argv[3]) : 4;
+    uint32_t depth = argc > 4 ? atoi(argv[4]) : 16;
+    if (requests == 0 || connections == 0 || depth == 0) usage(argv[0]);
+
+    uint32_t total = requests * connections;
+    uint64_t *latencies_ns = malloc(sizeof(uint64_t) * total);
+    client_t *clients = calloc(connections, sizeof(client_t));
+    pthread_t threads[connections];
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < connections; i++) {
+        client_t *client = &clients[i];
+        client->socket_path = argv[1];
+        client->requests = requests;
+        client->depth = depth;
+        client->sent = malloc(sizeof(struct timespec) * requests);
+        client->latencies_ns = latencies_ns + i * requests;
+        pthread_mutex_init(&client->lock, NULL);
+        pthread_cond_init(&client->cond, NULL);
+        pthread_create(&threads[i], NULL, client_main, client);
+    }
+
+    uint32_t failed = 0;
+    for (uint32_t i = 0; i < connections; i++) {
+        pthread_join(threads[i], NULL);
+        failed += clients[i].failed;
+        free(clients[i].sent);
+    }
+    double seconds = elapsed_ns(&start) / 1e9;
+
+    qsort(latencies_ns, total, sizeof(uint64_t), compare_u64);
+    printf("%u requests in %.3fs (%.0f/s), %u failed\n",
+        total, seconds, total / seconds, failed);
+    printf("latency_us p50 %.1f p90 %.1f p99 %.1f max %.1f\n",
+        latencies_ns[total / 2] / 1e3,
+        latencies_ns[total * 9 / 10] / 1e3,
+        latencies_ns[total * 99 / 100] / 1e3,
+        latencies_ns[total - 1] / 1e3);
+
+    free(clients);
+    free(latencies_ns);
+    return failed > 0;
+}